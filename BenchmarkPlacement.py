@@ -0,0 +1,52 @@
+# Measures the cross-socket penalty of the reader/writer pipeline on a multi-socket host.
+# Usage: python BenchmarkPlacement.py <MultiCopy.exe> <input_file> <output_file>
+#            --cpu-a <cpu on socket 0> --cpu-b <other cpu on socket 0> --cpu-c <cpu on socket 1>
+# Run it from a directory where MultiCopy may create its log files.
+import argparse
+import os
+import statistics
+import subprocess
+import time
+
+parser = argparse.ArgumentParser()
+parser.add_argument("exe")
+parser.add_argument("input")
+parser.add_argument("output")
+parser.add_argument("--cpu-a", type=int, required=True)
+parser.add_argument("--cpu-b", type=int, required=True)
+parser.add_argument("--cpu-c", type=int, required=True)
+parser.add_argument("--node-c", type=int, default=1, help="NUMA node of cpu-c")
+parser.add_argument("--runs", type=int, default=5)
+args = parser.parse_args()
+
+scenarios = {
+    "no placement": [],
+    "cross socket, memory on writer node": ["--reader-cpu", str(args.cpu_a), "--writer-cpu", str(args.cpu_c),
+                                            "--numa-node", str(args.node_c)],
+    "same socket, shared node": ["--reader-cpu", str(args.cpu_a), "--writer-cpu", str(args.cpu_b)],
+}
+
+
+def copy_once(options, run):
+    if os.path.exists(args.output):
+        os.remove(args.output)
+    command = [args.exe, args.input, args.output, f"MultiCopyBench{os.getpid()}_{run}"] + options
+    reader = subprocess.Popen(command, stdout=subprocess.DEVNULL)
+    time.sleep(0.2)  # Let the first process take the reader role. Copy starts with the writer.
+    start = time.perf_counter()
+    writer = subprocess.Popen(command, stdout=subprocess.DEVNULL)
+    if reader.wait() != 0 or writer.wait() != 0:
+        raise RuntimeError(f"Copy failed: {' '.join(command)}")
+    return time.perf_counter() - start
+
+
+size = os.path.getsize(args.input)
+copy_once([], "warmup")  # Source in the page cache for all scenarios.
+run = 0
+for name, options in scenarios.items():
+    times = []
+    for _ in range(args.runs):
+        times.append(copy_once(options, run))
+        run += 1
+    median = statistics.median(times)
+    print(f"{name:40} median {median:7.3f} s  {size / median / 1e9:6.2f} GB/s")
@@ -1,16 +1,22 @@
 #pragma once
+#include <cstddef>
 #include <spdlog/spdlog.h>
 
-constexpr std::streamsize BLOCK_SIZE = 1'000'000;
-constexpr std::streamsize BLOCK_NUM = 3;
+constexpr std::streamsize BLOCK_CAPACITY = 4'000'000; // Largest block size, allocated for each block with --autotune.
+constexpr std::streamsize BLOCK_SIZE = 1'000'000; // Default number of bytes transferred in one block.
+constexpr std::streamsize BLOCK_NUM = 8; // Largest number of blocks in flight, allocated with --autotune.
+constexpr std::streamsize BLOCK_DEPTH = 3; // Default number of blocks in flight.
 
+// Block header in shared memory. Its data follow right after it.
 struct Block {
 	explicit Block(int id_);
 	~Block();
-	char data[BLOCK_SIZE] {};
+	[[nodiscard]] char* Data() { return reinterpret_cast<char*>(this + 1); }
     std::streamsize size = 0;
+	std::streamoff offset = 0; // Position of the data in the file.
     int id = -1; // Unique identifier for the block, can be used for debugging or tracking.
 	bool error = true; // Set it to false when a block of data is successfully read.
+	bool last = false; // Set by reader on the block containing the end of file.
 };
 
 inline Block::Block(const int id_) : id(id_)
@@ -23,4 +29,21 @@ inline Block::~Block()
     spdlog::debug("Destructing block {}.", id);
 }
 
-using BlocksArray = std::array<Block, BLOCK_NUM>;
+// Blocks allocated in shared memory. Both processes compute it from the same command-line parameters.
+struct BlockLayout {
+	int count; // Blocks in the ring.
+	std::streamsize capacity; // Data bytes of each block.
+
+	// Distance between two block headers, keeps the headers aligned.
+	[[nodiscard]] std::size_t Stride() const
+	{
+		const auto data = static_cast<std::size_t>(capacity);
+		return sizeof(Block) + (data + alignof(Block) - 1) / alignof(Block) * alignof(Block);
+	}
+	[[nodiscard]] std::size_t Bytes() const { return static_cast<std::size_t>(count) * Stride(); }
+	[[nodiscard]] Block& At(char* blocks, const int index) const
+	{
+		return *reinterpret_cast<Block*>(blocks + static_cast<std::size_t>(index) * Stride());
+	}
+	bool operator==(const BlockLayout&) const = default;
+};
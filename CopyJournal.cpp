@@ -0,0 +1,179 @@
+#include "CopyJournal.h"
+#include "Block.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+#include <spdlog/spdlog.h>
+
+namespace
+{
+	constexpr char JOURNAL_MAGIC[8] = { 'M', 'C', 'J', 'R', 'N', 'L', '0', '1' };
+	// Data confirmed by one batch of records. Each batch costs a flush of the output and the journal,
+	// a crash loses at most this much of the copy.
+	constexpr std::streamsize JOURNAL_BATCH_BYTES = 64'000'000;
+	// Trailing records checked against the output. When none of them matches, the output is not the one
+	// the journal describes and the copy starts over.
+	constexpr int MAX_HASH_CHECKS = 4;
+}
+
+CopyJournal::CopyJournal(const std::string& outputFileName) : outputName_(outputFileName), name_(outputFileName + ".mcjournal")
+{
+}
+
+std::streamoff CopyJournal::Prepare(const std::string& inputFileName)
+{
+	Header current{};
+	std::memcpy(current.magic, JOURNAL_MAGIC, sizeof current.magic);
+	current.sourceSize = std::filesystem::file_size(inputFileName);
+	current.sourceTime = static_cast<std::int64_t>(std::filesystem::last_write_time(inputFileName).time_since_epoch().count());
+
+	std::error_code error;
+	const std::uintmax_t outputSize = std::filesystem::file_size(outputName_, error);
+	const auto outputEnd = error ? std::int64_t{ 0 } : static_cast<std::int64_t>(outputSize);
+
+	// Count records forming a contiguous range from the start of the file and within the output.
+	std::int64_t validRecords = 0;
+	bool sameSource = false;
+	{
+		std::ifstream journal(name_, std::ios::binary);
+		Header stored{};
+		if (journal.read(reinterpret_cast<char*>(&stored), sizeof stored))
+		{
+			sameSource = std::memcmp(stored.magic, current.magic, sizeof stored.magic) == 0
+				&& stored.sourceSize == current.sourceSize
+				&& stored.sourceTime == current.sourceTime;
+			if (!sameSource)
+			{
+				spdlog::info("Journal {} belongs to a different source, copying from the beginning.", name_);
+			}
+		}
+		Record record{};
+		std::int64_t expectedOffset = 0;
+		while (sameSource && journal.read(reinterpret_cast<char*>(&record), sizeof record)
+			&& record.offset == expectedOffset && record.size > 0 && record.size <= BLOCK_CAPACITY
+			&& record.offset + record.size <= outputEnd)
+		{
+			expectedOffset += record.size;
+			++validRecords;
+		}
+	}
+
+	// Records are written only after their data are on the disk, so they survive a crash of the OS too.
+	// Check the trailing records anyway to catch output truncated or replaced since, earlier records are trusted.
+	std::streamoff offset = 0;
+	{
+		std::ifstream journal(name_, std::ios::binary);
+		std::ifstream output(outputName_, std::ios::binary);
+		std::vector<char> buffer;
+		for (int checks = 0; validRecords > 0; --validRecords)
+		{
+			Record record{};
+			journal.seekg(static_cast<std::streamoff>(sizeof(Header) + static_cast<std::size_t>(validRecords - 1) * sizeof(Record)));
+			if (journal.read(reinterpret_cast<char*>(&record), sizeof record) && Matches(output, buffer, record))
+			{
+				offset = record.offset + record.size;
+				break;
+			}
+			spdlog::debug("Journal record at offset {} does not match the output file.", record.offset);
+			if (++checks == MAX_HASH_CHECKS)
+			{
+				spdlog::info("Output {} does not match journal {}, copying from the beginning.", outputName_, name_);
+				validRecords = 0;
+				break;
+			}
+		}
+	}
+
+	if (sameSource)
+	{
+		std::filesystem::resize_file(name_, sizeof(Header) + static_cast<std::size_t>(validRecords) * sizeof(Record));
+	}
+	else
+	{
+		OutputFile journal(name_, false);
+		if (!journal.IsOpen())
+		{
+			throw std::runtime_error("Failed to create journal: " + name_);
+		}
+		journal.Write(0, reinterpret_cast<const char*>(&current), sizeof current);
+		journal.Flush();
+	}
+	spdlog::info("Copy continues from offset {} of {} bytes.", offset, current.sourceSize);
+	return offset;
+}
+
+void CopyJournal::Confirm(OutputFile& output, const std::streamoff offset, const char* data, const std::streamsize size)
+{
+	if (size == 0)
+	{
+		return;
+	}
+	pending_.push_back({ offset, size, Hash(data, size) });
+	pendingBytes_ += size;
+	if (pendingBytes_ >= JOURNAL_BATCH_BYTES)
+	{
+		Commit(output);
+	}
+}
+
+void CopyJournal::Commit(OutputFile& output)
+{
+	output.Flush();
+	if (!file_)
+	{
+		file_.emplace(name_, true);
+		if (!file_->IsOpen())
+		{
+			throw std::runtime_error("Failed to open journal: " + name_);
+		}
+		fileSize_ = file_->Size();
+	}
+	const auto bytes = static_cast<std::streamsize>(pending_.size() * sizeof(Record));
+	file_->Write(fileSize_, reinterpret_cast<const char*>(pending_.data()), bytes);
+	file_->Flush();
+	fileSize_ += bytes;
+	pending_.clear();
+	pendingBytes_ = 0;
+}
+
+void CopyJournal::Finish(OutputFile& output)
+{
+	output.Flush(); // Complete copy must be on the disk before the journal goes away.
+	file_.reset();
+	std::error_code error;
+	if (!std::filesystem::remove(name_, error) && error)
+	{
+		spdlog::error("Failed to remove journal {}: {}", name_, error.message());
+	}
+}
+
+// Integrity check only, not a cryptographic hash. Mixes 8 bytes at a time to keep up with the copy.
+std::uint64_t CopyJournal::Hash(const char* data, const std::streamsize size)
+{
+	constexpr std::uint64_t prime = 0x100000001b3ULL;
+	std::uint64_t hash = 0xcbf29ce484222325ULL ^ static_cast<std::uint64_t>(size);
+	std::streamsize i = 0;
+	for (; i + 8 <= size; i += 8)
+	{
+		std::uint64_t word;
+		std::memcpy(&word, data + i, sizeof word);
+		hash = (hash ^ word) * prime;
+		hash ^= hash >> 29;
+	}
+	for (; i < size; ++i)
+	{
+		hash = (hash ^ static_cast<unsigned char>(data[i])) * prime;
+	}
+	return hash;
+}
+
+bool CopyJournal::Matches(std::ifstream& output, std::vector<char>& buffer, const Record& record)
+{
+	buffer.resize(static_cast<std::size_t>(record.size));
+	output.clear();
+	output.seekg(record.offset);
+	return output.read(buffer.data(), record.size) && Hash(buffer.data(), record.size) == record.hash;
+}
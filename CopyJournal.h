@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <ios>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "OutputFile.h"
+
+// Journal of blocks confirmed as written to the output file. Lets an interrupted copy continue
+// from the first unconfirmed offset instead of starting over.
+// File <output>.mcjournal holds a header describing the source file followed by one record per block.
+// Reader validates the journal and decides where to continue, writer appends records.
+// Records are appended in batches, each only after the output data it confirms are flushed to the disk.
+class CopyJournal {
+public:
+	explicit CopyJournal(const std::string& outputFileName);
+	CopyJournal(const CopyJournal& other) = delete;
+	CopyJournal& operator=(const CopyJournal&) = delete;
+
+	// Reader only. Call before the first block is handed to the writer.
+	// Keeps the records matching the source and the output file and returns the offset to continue from.
+	// Starts a new journal and returns 0 when there is nothing to continue.
+	std::streamoff Prepare(const std::string& inputFileName);
+	// Writer only. Call after the block data are written to the output file.
+	void Confirm(OutputFile& output, std::streamoff offset, const char* data, std::streamsize size);
+	// Writer only. Flushes the output and removes the journal when the copy is complete.
+	void Finish(OutputFile& output);
+
+	static std::uint64_t Hash(const char* data, std::streamsize size);
+
+private:
+	struct Header {
+		char magic[8];
+		std::uint64_t sourceSize;
+		std::int64_t sourceTime;
+	};
+
+	struct Record {
+		std::int64_t offset;
+		std::int64_t size;
+		std::uint64_t hash;
+	};
+
+	// Reuses the output stream and the buffer over consecutive checks.
+	static bool Matches(std::ifstream& output, std::vector<char>& buffer, const Record& record);
+	void Commit(OutputFile& output);
+
+	std::string outputName_;
+	std::string name_;
+	std::optional<OutputFile> file_;
+	std::streamoff fileSize_ = 0;
+	std::vector<Record> pending_;
+	std::streamsize pendingBytes_ = 0;
+};
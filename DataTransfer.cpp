@@ -1,9 +1,14 @@
 #include "DataTransfer.h"
+#include "Placement.h"
 #include "Utils.h"
 #include <windows.h>
+#include <cstdint>
+#include <cstring>
+#include <optional>
 #include <stdexcept>
 #include <vector>
 #include <string>
+#include <chrono>
 #include <spdlog/spdlog.h>
 
 using namespace std::literals::string_literals;
@@ -11,7 +16,18 @@ using namespace std::literals::string_literals;
 std::string EmptyBlocksSemaphoreName = "MultiCopyEmptyBlocksSemaphore_"s;
 std::string BlocsToWriteSemaphoreName = "MultiCopyBlocksToWriteSemaphore_"s;
 
+static_assert(sizeof(SharedMemory) % alignof(Block) == 0, "Blocks follow SharedMemory and must stay aligned.");
+
+namespace
+{
+	char* BlocksOf(SharedMemory* sharedMemory)
+	{
+		return reinterpret_cast<char*>(sharedMemory + 1);
+	}
+}
+
 DataTransfer::DataTransfer(DataTransfer&& other) noexcept: sharedMemory_{other.sharedMemory_},
+                                                           layout_{other.layout_},
                                                            emptyBlocksSemaphore_{std::move(other.emptyBlocksSemaphore_)},
                                                            blocksToWriteSemaphore_{std::move(other.blocksToWriteSemaphore_)},
                                                            hMapping_{other.hMapping_}
@@ -26,17 +42,31 @@ DataTransfer::~DataTransfer()
 	spdlog::debug("Shared memory released.");
 }
 
-DataTransfer::DataTransfer(const std::string& sharedMemoryOSName, RoleCheck::Role role) : name_(sharedMemoryOSName)
+DataTransfer::DataTransfer(const std::string& sharedMemoryOSName, RoleCheck::Role role, const int numaNode, const BlockLayout layout) :
+	name_(sharedMemoryOSName),
+	layout_(layout)
 {
 	const auto sharedMemoryOsName = StringToWChar(sharedMemoryOSName);
+	const DWORD preferredNode = numaNode == ANY_NUMA_NODE ? NUMA_NO_PREFERRED_NODE : static_cast<DWORD>(numaNode);
+	// Only the blocks the reader was configured for, not the autotune maximum.
+	const std::uint64_t mappingSize = sizeof(SharedMemory) + layout.Bytes();
 
-	hMapping_ = CreateFileMapping(
+	// Reader touches every page first while constructing the blocks, it runs on the chosen node until then.
+	// Switching before the mapping exists leaves nothing to release when it fails.
+	std::optional<ThreadOnNumaNode> onNode;
+	if (role == RoleCheck::Role::Reader)
+	{
+		onNode.emplace(numaNode);
+	}
+
+	hMapping_ = CreateFileMappingNuma(
 		INVALID_HANDLE_VALUE,    // use paging file
 		nullptr,                 // default security
 		PAGE_READWRITE,          // read/write access
-		0,                       // maximum object size (high-order DWORD)
-		sizeof(SharedMemory),    // maximum object size (low-order DWORD)
-		sharedMemoryOsName.data());     // name of mapping object
+		static_cast<DWORD>(mappingSize >> 32),          // maximum object size (high-order DWORD)
+		static_cast<DWORD>(mappingSize & 0xFFFF'FFFF),  // maximum object size (low-order DWORD)
+		sharedMemoryOsName.data(),      // name of mapping object
+		preferredNode);          // NUMA node for pages of the mapping
 	if (hMapping_ == nullptr)
 	{
 
@@ -45,26 +75,45 @@ DataTransfer::DataTransfer(const std::string& sharedMemoryOSName, RoleCheck::Rol
 		const std::string errorMessage = std::format("Failed to create file mapping: {} - {}.", std::to_string(errCode), systemMessage);
 		throw std::runtime_error(errorMessage);
 	}
-	void* memPtr = MapViewOfFile(
+	void* memPtr = MapViewOfFileExNuma(
 		hMapping_,
 		FILE_MAP_ALL_ACCESS, // read/write access
 		0,
 		0,
-		sizeof(SharedMemory));
+		role == RoleCheck::Role::Reader ? static_cast<SIZE_T>(mappingSize) : 0, // writer maps whole section, reader decided its size
+		nullptr,             // any address
+		preferredNode);
 	if (memPtr == nullptr)
 	{
 		CloseHandle(hMapping_);
 		throw std::runtime_error("Failed to map view of file: " + std::to_string(GetLastError()));
 	}
 	// Prevent double init
-	sharedMemory_ = role == RoleCheck::Role::Reader ? new (memPtr) SharedMemory() : static_cast<SharedMemory*>(memPtr);
+	if (role == RoleCheck::Role::Reader)
+	{
+		sharedMemory_ = new (memPtr) SharedMemory();
+		sharedMemory_->Layout = layout_;
+		for (int i = 0; i < layout_.count; ++i)
+		{
+			Block& block = *new (&layout_.At(BlocksOf(sharedMemory_), i)) Block{ i };
+			std::memset(block.Data(), 0, static_cast<std::size_t>(layout_.capacity));
+		}
+	}
+	else
+	{
+		sharedMemory_ = static_cast<SharedMemory*>(memPtr);
+	}
 }
 
-void DataTransfer::InitReading()
+void DataTransfer::InitReading(const int depth, const bool resume)
 {
-	for (int i = 0; i < BLOCK_NUM; ++i)
+	sharedMemory_->Resume = resume;
+	for (int i = 0; i < layout_.count; ++i)
+	{
+		layout_.At(BlocksOf(sharedMemory_), i).error = false;
+	}
+	for (int i = 0; i < depth; ++i)
 	{
-		sharedMemory_->blocks[i].error = false;
 		emptyBlocksSemaphore_.Signal();
 	}
 }
@@ -74,13 +123,52 @@ std::string DataTransfer::GetName()
 	return name_;
 }
 
+bool DataTransfer::IsResuming() const
+{
+	return sharedMemory_->Resume;
+}
+
+bool DataTransfer::LayoutMatchesReader() const
+{
+	return sharedMemory_->Layout == layout_;
+}
+
+// Blocks are taken from the ring in order, so the number of empty block permits limits blocks in flight
+// without changing which block comes next.
+// ReSharper disable once CppMemberFunctionMayBeConst // This function modifies the semaphore state.
+void DataTransfer::GrowDepth()
+{
+	emptyBlocksSemaphore_.Signal();
+}
+
+// ReSharper disable once CppMemberFunctionMayBeConst // This function modifies the semaphore state.
+void DataTransfer::ShrinkDepth()
+{
+	if (const auto res = emptyBlocksSemaphore_.Wait(); res != Semaphore::WaitResult::Signaled)
+	{
+		throw std::runtime_error("Failed to shrink pipeline depth: " + std::to_string(static_cast<int>(res)));
+	}
+}
+
+DataTransfer::StallTimes DataTransfer::GetStallTimes() const
+{
+	return {
+		std::chrono::nanoseconds{ sharedMemory_->ReaderStallNs.load(std::memory_order_relaxed) },
+		std::chrono::nanoseconds{ sharedMemory_->WriterStallNs.load(std::memory_order_relaxed) }
+	};
+}
+
 DataTransfer::DataTransferInterface::DataTransferInterface(
-	BlocksArray* blocks,
+	SharedMemory* shared,
+	const BlockLayout layout,
 	int* counterIn,
+	std::atomic<long long>* stallNs,
 	Semaphore* semaphoreIn,
 	Semaphore* semaphoreOut) :
-	shared_(blocks),
+	shared_(shared),
+	layout_(layout),
 	counterIn_(counterIn),
+	stallNs_(stallNs),
 	semaphoreIn_(semaphoreIn),
 	semaphoreOut_(semaphoreOut)
 {}
@@ -88,12 +176,13 @@ DataTransfer::DataTransferInterface::DataTransferInterface(
 // ReSharper disable once CppMemberFunctionMayBeConst // This function modifies the semaphore state. And that changes behavior of the object.
 Block& DataTransfer::DataTransferInterface::GetBlock()
 {
+	const auto waitStart = std::chrono::steady_clock::now();
 	auto res = semaphoreIn_->Wait(); // No block released in timeout is considered as other side not working or broken pipeline.
+	stallNs_->fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - waitStart).count(), std::memory_order_relaxed);
 	if (res == Semaphore::WaitResult::Signaled)
 	{
-		auto& shared = *shared_;
 		auto& counterIn = *counterIn_;
-		Block& block = shared[counterIn++ % BLOCK_NUM];
+		Block& block = layout_.At(BlocksOf(shared_), counterIn++ % layout_.count);
 		if (block.error)
 		{
 			spdlog::debug("Error found in block #{}.", block.id);
@@ -110,12 +199,24 @@ void DataTransfer::DataTransferInterface::SignalBlock()
 	semaphoreOut_->Signal();
 }
 
+// ReSharper disable once CppMemberFunctionMayBeConst // This function modifies the semaphore state. And that changes behavior of the object.
+void DataTransfer::DataTransferInterface::SignalError()
+{
+	// Layout of the reader, it matches the mapped section even when this process got other parameters.
+	const BlockLayout& layout = shared_->Layout;
+	for (int i = 0; i < layout.count; ++i)
+	{
+		layout.At(BlocksOf(shared_), i).error = true;
+	}
+	SignalBlock();
+}
+
 DataTransfer::DataTransferInterface DataTransfer::GetReaderInterface()
 {
-	return DataTransferInterface(&(sharedMemory_->blocks), &sharedMemory_->NextReadBlock, &emptyBlocksSemaphore_, &blocksToWriteSemaphore_);
+	return DataTransferInterface(sharedMemory_, layout_, &sharedMemory_->NextReadBlock, &sharedMemory_->ReaderStallNs, &emptyBlocksSemaphore_, &blocksToWriteSemaphore_);
 }
 
 DataTransfer::DataTransferInterface DataTransfer::GetWriterInterface()
 {
-	return DataTransferInterface(&(sharedMemory_->blocks), &sharedMemory_->NextWriteBlock, &blocksToWriteSemaphore_, &emptyBlocksSemaphore_);
+	return DataTransferInterface(sharedMemory_, layout_, &sharedMemory_->NextWriteBlock, &sharedMemory_->WriterStallNs, &blocksToWriteSemaphore_, &emptyBlocksSemaphore_);
 }
@@ -1,5 +1,6 @@
 #pragma once
-#include <array>
+#include <atomic>
+#include <chrono>
 #include <string>
 
 #include "Block.h"
@@ -13,30 +14,57 @@ extern std::string BlocsToWriteSemaphoreName;
 struct SharedMemory {
 	int NextReadBlock = 0;
 	int NextWriteBlock = 0;
-	BlocksArray blocks = { Block{0}, Block{1}, Block{2} }; // Can we use https://en.cppreference.com/w/cpp/utility/integer_sequence.html
+	// Time each side spent blocked in GetBlock. Read by the reader to tune the pipeline.
+	std::atomic<long long> ReaderStallNs = 0;
+	std::atomic<long long> WriterStallNs = 0;
+	BlockLayout Layout{}; // Set by reader, writer checks it got the same parameters.
+	bool Resume = false; // Set by reader, writer keeps the output and journals the copy.
+	// Blocks follow, see BlockLayout.
 };
 
 class DataTransfer
 {
 public:
-	DataTransfer(const std::string& sharedMemoryOSName, RoleCheck::Role role);
+	// numaNode is the preferred node of the shared memory pages, ANY_NUMA_NODE for no preference.
+	DataTransfer(const std::string& sharedMemoryOSName, RoleCheck::Role role, int numaNode, BlockLayout layout);
 	DataTransfer(const DataTransfer& other) = delete;
 	DataTransfer& operator=(const DataTransfer&) = delete; // No assignment allowed.
 	DataTransfer(DataTransfer&& other) noexcept;
 	~DataTransfer();
 
 	// Call only one time in the beginning of the reading process.
-	void InitReading();
+	// depth is the number of blocks in flight, at most the layout count.
+	// resume tells the writer to continue an interrupted copy.
+	void InitReading(int depth, bool resume);
 	std::string GetName();
+	// Writer only. Valid after the first block was received, the reader sets it up before.
+	[[nodiscard]] bool IsResuming() const;
+	// Writer only. Valid after the first block was received. False when reader got other block parameters.
+	[[nodiscard]] bool LayoutMatchesReader() const;
+
+	// Reader only. Lets one more block be in flight. Caller keeps the total at most the layout count.
+	void GrowDepth();
+	// Reader only. Takes one empty block out of the ring. Waits until the writer returns one.
+	void ShrinkDepth();
+
+	struct StallTimes {
+		std::chrono::nanoseconds reader;
+		std::chrono::nanoseconds writer;
+	};
+	[[nodiscard]] StallTimes GetStallTimes() const;
 
 	class DataTransferInterface {
 	public:
-		explicit DataTransferInterface(BlocksArray* blocks, int* counterIn, Semaphore* semaphoreIn, Semaphore* semaphoreOut);
+		explicit DataTransferInterface(SharedMemory* shared, BlockLayout layout, int* counterIn, std::atomic<long long>* stallNs, Semaphore* semaphoreIn, Semaphore* semaphoreOut);
 		Block& GetBlock();
 		void SignalBlock();
+		// Marks every block as error and signals, so the other process stops whichever block it takes next.
+		void SignalError();
 	private:
-		BlocksArray* shared_;
+		SharedMemory* shared_;
+		BlockLayout layout_;
 		int* counterIn_;
+		std::atomic<long long>* stallNs_;
 		Semaphore* semaphoreIn_;
 		Semaphore* semaphoreOut_;
 	};
@@ -48,6 +76,7 @@ private:
 	// consider using a message queue
 	std::string name_;
 	SharedMemory* sharedMemory_ = nullptr;
+	BlockLayout layout_;
 	Semaphore emptyBlocksSemaphore_{ EmptyBlocksSemaphoreName + name_ };
 	Semaphore blocksToWriteSemaphore_{ BlocsToWriteSemaphoreName + name_ };
 	HANDLE hMapping_;
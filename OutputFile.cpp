@@ -0,0 +1,84 @@
+#include "OutputFile.h"
+#include "Utils.h"
+
+#include <format>
+#include <stdexcept>
+#include <spdlog/spdlog.h>
+
+OutputFile::OutputFile(const std::string& filename, const bool keepContent) : name_(filename)
+{
+	const auto wideName = StringToWChar(filename);
+	handle_ = CreateFileW(
+		wideName.data(),
+		GENERIC_WRITE,
+		FILE_SHARE_READ | FILE_SHARE_WRITE, // reader checks the output when resuming
+		nullptr,
+		keepContent ? OPEN_ALWAYS : CREATE_ALWAYS,
+		FILE_ATTRIBUTE_NORMAL,
+		nullptr);
+	if (handle_ == INVALID_HANDLE_VALUE)
+	{
+		spdlog::debug("Error opening output file: {}: {}", filename, GetLastErrorMessage(GetLastError()));
+	}
+	spdlog::debug("Opening output file: {}", filename);
+}
+
+OutputFile::~OutputFile()
+{
+	Close();
+}
+
+bool OutputFile::IsOpen() const
+{
+	return handle_ != INVALID_HANDLE_VALUE;
+}
+
+std::streamoff OutputFile::Size() const
+{
+	LARGE_INTEGER size{};
+	if (!GetFileSizeEx(handle_, &size))
+	{
+		throw std::runtime_error(std::format("Failed to get size of {}: {}", name_, GetLastErrorMessage(GetLastError())));
+	}
+	return size.QuadPart;
+}
+
+void OutputFile::Write(const std::streamoff offset, const char* data, const std::streamsize size)
+{
+	OVERLAPPED position{};
+	position.Offset = static_cast<DWORD>(offset & 0xFFFF'FFFF);
+	position.OffsetHigh = static_cast<DWORD>(offset >> 32);
+	DWORD written = 0;
+	if (!WriteFile(handle_, data, static_cast<DWORD>(size), &written, &position) || written != size)
+	{
+		throw std::runtime_error(std::format("Failed to write to {}: {}", name_, GetLastErrorMessage(GetLastError())));
+	}
+}
+
+void OutputFile::Flush()
+{
+	if (!FlushFileBuffers(handle_))
+	{
+		throw std::runtime_error(std::format("Failed to flush {}: {}", name_, GetLastErrorMessage(GetLastError())));
+	}
+}
+
+void OutputFile::Truncate(const std::streamoff size)
+{
+	LARGE_INTEGER position{};
+	position.QuadPart = size;
+	if (!SetFilePointerEx(handle_, position, nullptr, FILE_BEGIN) || !SetEndOfFile(handle_))
+	{
+		throw std::runtime_error(std::format("Failed to truncate {}: {}", name_, GetLastErrorMessage(GetLastError())));
+	}
+}
+
+void OutputFile::Close()
+{
+	if (handle_ != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(handle_);
+		handle_ = INVALID_HANDLE_VALUE;
+		spdlog::debug("Output file {} closed.", name_);
+	}
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <ios>
+#include <string>
+#include <windows.h>
+
+// File written through Win32 API, so written data can be flushed to the disk.
+class OutputFile {
+public:
+	// keepContent opens an existing file without truncating it.
+	OutputFile(const std::string& filename, bool keepContent);
+	~OutputFile();
+	OutputFile(const OutputFile& other) = delete;
+	OutputFile& operator=(const OutputFile&) = delete;
+
+	[[nodiscard]] bool IsOpen() const;
+	[[nodiscard]] std::streamoff Size() const;
+	void Write(std::streamoff offset, const char* data, std::streamsize size);
+	// Returns when all written data are on the disk.
+	void Flush();
+	void Truncate(std::streamoff size);
+	void Close();
+
+private:
+	HANDLE handle_ = INVALID_HANDLE_VALUE;
+	std::string name_;
+};
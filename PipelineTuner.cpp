@@ -0,0 +1,175 @@
+#include "PipelineTuner.h"
+
+#include <algorithm>
+#include <spdlog/spdlog.h>
+
+namespace
+{
+	constexpr int WINDOW_BLOCKS = 8; // Blocks measured before each decision.
+	constexpr int MAX_WINDOWS = 16; // Tuning stops after this many windows.
+	constexpr int STABLE_WINDOWS_TO_SETTLE = 2; // Tuning stops earlier when nothing changed in this many windows.
+	constexpr int MIN_DEPTH = 2; // Keep at least one block being read while the other one is written.
+	constexpr std::streamsize MIN_BLOCK_SIZE = 125'000;
+	constexpr double STALL_THRESHOLD = 0.10; // Part of the window a side waits for a block to consider it starving.
+	constexpr double IDLE_THRESHOLD = 0.02; // Part of the window below which a side is considered never waiting.
+	constexpr double THROUGHPUT_TOLERANCE = 0.95; // Change is reverted when throughput falls below this part of the previous window.
+}
+
+PipelineTuner::PipelineTuner(const std::streamsize blockSize, const int depth) :
+	settings_{ blockSize, depth },
+	previousSettings_{ blockSize, depth },
+	// Reader fills the starting blocks and then waits in GetBlock of the next one until the writer process
+	// starts and returns a block. Measuring starts after that wait.
+	warmupBlocks_(depth + 1)
+{
+}
+
+PipelineTuner::Settings PipelineTuner::OnBlock(const std::streamsize bytes, const DataTransfer::StallTimes& stalls)
+{
+	if (settled_)
+	{
+		return settings_;
+	}
+	if (warmupBlocks_ > 0)
+	{
+		if (--warmupBlocks_ == 0)
+		{
+			windowStart_ = std::chrono::steady_clock::now();
+			windowStartStalls_ = stalls;
+		}
+		return settings_;
+	}
+	windowBytes_ += bytes;
+	if (++windowBlocks_ < WINDOW_BLOCKS)
+	{
+		return settings_;
+	}
+	EvaluateWindow(stalls);
+	windowBlocks_ = 0;
+	windowBytes_ = 0;
+	windowStart_ = std::chrono::steady_clock::now();
+	windowStartStalls_ = stalls;
+	return settings_;
+}
+
+void PipelineTuner::Report()
+{
+	if (reported_)
+	{
+		return;
+	}
+	reported_ = true;
+	spdlog::info("Autotune {} block size {} bytes and {} blocks in flight. Pin them with: --block-size {} --blocks {}",
+		settled_ ? "settled on" : "stopped at end of file with",
+		settings_.blockSize, settings_.depth, settings_.blockSize, settings_.depth);
+}
+
+void PipelineTuner::EvaluateWindow(const DataTransfer::StallTimes& stalls)
+{
+	using Seconds = std::chrono::duration<double>;
+	const double seconds = Seconds(std::chrono::steady_clock::now() - windowStart_).count();
+	if (seconds <= 0.0)
+	{
+		return;
+	}
+	const double throughput = static_cast<double>(windowBytes_) / seconds;
+	const double readerStall = Seconds(stalls.reader - windowStartStalls_.reader).count() / seconds;
+	const double writerStall = Seconds(stalls.writer - windowStartStalls_.writer).count() / seconds;
+	++windows_;
+	spdlog::debug("Autotune window {}: {:.1f} MB/s, reader stall {:.0f}%, writer stall {:.0f}%, block size {}, depth {}.",
+		windows_, throughput / 1'000'000, readerStall * 100, writerStall * 100, settings_.blockSize, settings_.depth);
+
+	if (lastChange_ != Change::None && throughput < baselineThroughput_ * THROUGHPUT_TOLERANCE)
+	{
+		Revert();
+		stableWindows_ = 0;
+	}
+	else
+	{
+		baselineThroughput_ = throughput;
+		// The last change is kept. Going back would undo it without a throughput check, so the opposite is not tried.
+		switch (lastChange_) {
+		case Change::GrowDepth: Freeze(Change::ShrinkDepth); break;
+		case Change::ShrinkDepth: Freeze(Change::GrowDepth); break;
+		case Change::GrowBlockSize: Freeze(Change::ShrinkBlockSize); break;
+		case Change::ShrinkBlockSize: Freeze(Change::GrowBlockSize); break;
+		default: break;
+		}
+		bool changed = false;
+		if (readerStall > STALL_THRESHOLD && writerStall > STALL_THRESHOLD)
+		{
+			// Both sides wait for each other: their speeds vary, more blocks in flight smooth it out.
+			changed = Apply(Change::GrowDepth) || Apply(Change::GrowBlockSize);
+		}
+		else if (readerStall > STALL_THRESHOLD || writerStall > STALL_THRESHOLD)
+		{
+			// One side is the bottleneck: larger blocks lower its per-block overhead.
+			changed = Apply(Change::GrowBlockSize);
+		}
+		else if (readerStall < IDLE_THRESHOLD && writerStall < IDLE_THRESHOLD)
+		{
+			// Nobody waits: smaller blocks stay in the CPU cache and fewer of them in flight lower latency.
+			changed = Apply(Change::ShrinkBlockSize) || Apply(Change::ShrinkDepth);
+		}
+		if (!changed)
+		{
+			lastChange_ = Change::None;
+		}
+		stableWindows_ = changed ? 0 : stableWindows_ + 1;
+	}
+
+	if (windows_ >= MAX_WINDOWS || stableWindows_ >= STABLE_WINDOWS_TO_SETTLE)
+	{
+		settled_ = true;
+		Report();
+	}
+}
+
+bool PipelineTuner::Apply(const Change change)
+{
+	if (frozen_[static_cast<int>(change)])
+	{
+		return false;
+	}
+	Settings next = settings_;
+	switch (change) {
+	case Change::GrowDepth:
+		if (next.depth >= BLOCK_NUM) return false;
+		++next.depth;
+		break;
+	case Change::ShrinkDepth:
+		if (next.depth <= MIN_DEPTH) return false;
+		--next.depth;
+		break;
+	case Change::GrowBlockSize:
+		if (next.blockSize >= BLOCK_CAPACITY) return false;
+		next.blockSize = std::min(next.blockSize * 2, BLOCK_CAPACITY);
+		break;
+	case Change::ShrinkBlockSize:
+		if (next.blockSize <= MIN_BLOCK_SIZE) return false;
+		next.blockSize = std::max(next.blockSize / 2, MIN_BLOCK_SIZE);
+		break;
+	default: return false;
+	}
+	previousSettings_ = settings_;
+	settings_ = next;
+	lastChange_ = change;
+	return true;
+}
+
+void PipelineTuner::Revert()
+{
+	if (lastChange_ == Change::None)
+	{
+		return;
+	}
+	Freeze(lastChange_);
+	spdlog::debug("Autotune: throughput dropped, reverting to block size {} and depth {}.", previousSettings_.blockSize, previousSettings_.depth);
+	settings_ = previousSettings_;
+	lastChange_ = Change::None;
+}
+
+void PipelineTuner::Freeze(const Change change)
+{
+	frozen_[static_cast<int>(change)] = true;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <chrono>
+#include <ios>
+
+#include "DataTransfer.h"
+
+// Tunes block size and number of blocks in flight during the first part of the copy.
+// Reader reports each block handed to the writer together with stall times of both sides
+// and applies the returned settings to the following blocks.
+class PipelineTuner {
+public:
+	PipelineTuner(std::streamsize blockSize, int depth);
+
+	struct Settings {
+		std::streamsize blockSize;
+		int depth;
+	};
+
+	// Call after each block is signaled to the writer.
+	Settings OnBlock(std::streamsize bytes, const DataTransfer::StallTimes& stalls);
+	// Logs settings the tuner ended with. Logs only once, either when tuning is settled or at the end of the copy.
+	void Report();
+
+private:
+	enum class Change : uint8_t {
+		None,
+		GrowDepth,
+		ShrinkDepth,
+		GrowBlockSize,
+		ShrinkBlockSize,
+		Count
+	};
+
+	void EvaluateWindow(const DataTransfer::StallTimes& stalls);
+	bool Apply(Change change);
+	void Revert();
+	// Change is not tried any more.
+	void Freeze(Change change);
+
+	Settings settings_;
+	Settings previousSettings_;
+	Change lastChange_ = Change::None;
+	bool frozen_[static_cast<int>(Change::Count)] = {};
+	bool settled_ = false;
+	bool reported_ = false;
+	int warmupBlocks_; // Blocks not measured at the start of the copy.
+	int windows_ = 0;
+	int stableWindows_ = 0;
+	int windowBlocks_ = 0;
+	std::streamsize windowBytes_ = 0;
+	double baselineThroughput_ = 0.0; // Bytes per second measured before the last change.
+	std::chrono::steady_clock::time_point windowStart_{};
+	DataTransfer::StallTimes windowStartStalls_{};
+};
@@ -0,0 +1,90 @@
+#include "Placement.h"
+#include "Utils.h"
+
+#include <format>
+#include <stdexcept>
+#include <spdlog/spdlog.h>
+
+namespace
+{
+	PROCESSOR_NUMBER ToProcessorNumber(const int cpu)
+	{
+		int remaining = cpu;
+		for (WORD group = 0; cpu >= 0 && group < GetActiveProcessorGroupCount(); ++group)
+		{
+			const auto count = static_cast<int>(GetActiveProcessorCount(group));
+			if (remaining < count)
+			{
+				PROCESSOR_NUMBER number{};
+				number.Group = group;
+				number.Number = static_cast<BYTE>(remaining);
+				return number;
+			}
+			remaining -= count;
+		}
+		throw std::runtime_error(std::format("CPU {} does not exist, there are {} CPUs.", cpu, GetActiveProcessorCount(ALL_PROCESSOR_GROUPS)));
+	}
+}
+
+void PinThreadToCpu(const int cpu)
+{
+	const PROCESSOR_NUMBER number = ToProcessorNumber(cpu);
+	GROUP_AFFINITY affinity{};
+	affinity.Group = number.Group;
+	affinity.Mask = KAFFINITY{ 1 } << number.Number;
+	if (!SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr))
+	{
+		throw std::runtime_error(std::format("Failed to pin to CPU {}: {}", cpu, GetLastErrorMessage(GetLastError())));
+	}
+	spdlog::info("Pinned to CPU {} (group {}, number {}).", cpu, number.Group, number.Number);
+}
+
+int GetCpuNumaNode(const int cpu)
+{
+	PROCESSOR_NUMBER number = ToProcessorNumber(cpu);
+	USHORT node = 0;
+	if (!GetNumaProcessorNodeEx(&number, &node))
+	{
+		throw std::runtime_error(std::format("Failed to get NUMA node of CPU {}: {}", cpu, GetLastErrorMessage(GetLastError())));
+	}
+	return node;
+}
+
+int ChooseNumaNode(const int numaNode, const int readerCpu, const int writerCpu)
+{
+	if (numaNode != ANY_NUMA_NODE)
+	{
+		return numaNode;
+	}
+	const int readerNode = readerCpu == ANY_CPU ? ANY_NUMA_NODE : GetCpuNumaNode(readerCpu);
+	const int writerNode = writerCpu == ANY_CPU ? ANY_NUMA_NODE : GetCpuNumaNode(writerCpu);
+	if (readerNode != ANY_NUMA_NODE && writerNode != ANY_NUMA_NODE && readerNode != writerNode)
+	{
+		spdlog::info("Reader CPU is on NUMA node {} and writer CPU on node {}, shared memory is not bound.", readerNode, writerNode);
+		return ANY_NUMA_NODE;
+	}
+	return readerNode != ANY_NUMA_NODE ? readerNode : writerNode;
+}
+
+ThreadOnNumaNode::ThreadOnNumaNode(const int numaNode)
+{
+	if (numaNode == ANY_NUMA_NODE)
+	{
+		return;
+	}
+	GROUP_AFFINITY nodeAffinity{};
+	if (!GetNumaNodeProcessorMaskEx(static_cast<USHORT>(numaNode), &nodeAffinity)
+		|| !SetThreadGroupAffinity(GetCurrentThread(), &nodeAffinity, &previous_))
+	{
+		throw std::runtime_error(std::format("Failed to run on NUMA node {}: {}", numaNode, GetLastErrorMessage(GetLastError())));
+	}
+	moved_ = true;
+}
+
+ThreadOnNumaNode::~ThreadOnNumaNode()
+{
+	if (moved_ && !SetThreadGroupAffinity(GetCurrentThread(), &previous_, nullptr))
+	{
+		spdlog::error("Failed to restore thread affinity: {}", GetLastErrorMessage(GetLastError()));
+	}
+}
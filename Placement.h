@@ -0,0 +1,27 @@
+#pragma once
+#include <windows.h>
+
+// CPU and NUMA placement of the reader, the writer and the shared memory.
+// CPUs are numbered across all processor groups, the same way Task Manager does.
+
+constexpr int ANY_CPU = -1;
+constexpr int ANY_NUMA_NODE = -1;
+
+// Pins the calling thread to one logical CPU.
+void PinThreadToCpu(int cpu);
+[[nodiscard]] int GetCpuNumaNode(int cpu);
+// Node for the shared memory: numaNode when given, otherwise the node shared by the given CPUs.
+// Returns ANY_NUMA_NODE when there is no such node.
+[[nodiscard]] int ChooseNumaNode(int numaNode, int readerCpu, int writerCpu);
+
+// Runs the calling thread on CPUs of one NUMA node while in scope, so memory it touches first is allocated there.
+class ThreadOnNumaNode {
+public:
+	explicit ThreadOnNumaNode(int numaNode);
+	~ThreadOnNumaNode();
+	ThreadOnNumaNode(const ThreadOnNumaNode& other) = delete;
+	ThreadOnNumaNode& operator=(const ThreadOnNumaNode&) = delete;
+private:
+	GROUP_AFFINITY previous_{};
+	bool moved_ = false;
+};
@@ -1,8 +1,7 @@
 #include "Semaphore.h"
 #include <spdlog/spdlog.h>
 #include "Utils.h"
-
-constexpr std::streamsize BLOCK_NUM = 3;
+#include "Block.h"
 
 Semaphore::Semaphore(const std::string& name) : name_(name) {
     const auto temp = std::wstring(name.begin(), name.end());
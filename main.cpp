@@ -5,22 +5,41 @@
 #include <spdlog/sinks/basic_file_sink.h>
 #include <spdlog/sinks/rotating_file_sink.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
+#include <charconv>
 #include <fstream>
 #include <iostream>
+#include <optional>
 
+#include "CopyJournal.h"
 #include "LoggingIfStream.h"
-#include "LoggingOfstream.h"
+#include "OutputFile.h"
+#include "Placement.h"
+#include "PipelineTuner.h"
 
 using namespace std::string_literals;
 
 namespace
 {
-	// Reads maximum BLOCK_SIZE bytes from the inputFile into block.
+	struct Config
+	{
+		std::string inputFileName;
+		std::string outputFileName;
+		std::string sharedMemoryName;
+		std::streamsize blockSize = BLOCK_SIZE;
+		int blockDepth = BLOCK_DEPTH;
+		bool autoTune = false;
+		bool resume = false;
+		int readerCpu = ANY_CPU;
+		int writerCpu = ANY_CPU;
+		int numaNode = ANY_NUMA_NODE;
+	};
+
+	// Reads maximum blockSize bytes from the inputFile into block.
 	// inputFileName is used only for error messages.
-	std::streamsize ReadFromFile(const std::string& inputFileName, std::ifstream& inputFile, Block& block)
+	std::streamsize ReadFromFile(const std::string& inputFileName, std::ifstream& inputFile, Block& block, const std::streamsize blockSize)
 	{
 		spdlog::info("Reading a block.");
-		inputFile.read(block.data, BLOCK_SIZE);
+		inputFile.read(block.Data(), blockSize);
 		if (inputFile.eof())
 		{
 			spdlog::info("End of file reached.");
@@ -35,6 +54,7 @@ namespace
 		}
 		block.size = inputFile.gcount();
 		block.error = false;
+		block.last = (block.size != blockSize);
 		spdlog::info("Loaded {} bytes to block {}.", block.size, block.id);
 		return block.size;
 	}
@@ -59,33 +79,83 @@ namespace
 		spdlog::info("Reader process finishing");
 	}
 
-	int DoRead(const std::string& inputFileName, DataTransfer dataTransfer)
+	// Hands the writer a block marked as error, so it does not wait forever, and finishes the reader.
+	int ReaderAbort(DataTransfer::DataTransferInterface& rdMem, DataTransfer dataTransfer)
+	{
+		Block& block = rdMem.GetBlock();
+		block.error = true;
+		rdMem.SignalBlock();  // Allow writer to get it and see error.
+		ReaderFinish(std::move(dataTransfer));
+		return EXIT_FAILURE;
+	}
+
+	int DoRead(const Config& config, DataTransfer dataTransfer)
 	{
 		spdlog::info("Reader process started.");
-		dataTransfer.InitReading();
+		const std::string& inputFileName = config.inputFileName;
+		std::streamsize blockSize = config.blockSize;
+		int depth = config.blockDepth;
+		dataTransfer.InitReading(depth, config.resume);
 		auto rdMem = dataTransfer.GetReaderInterface();
 		// open input file
 		LoggingIfstream inputFile(inputFileName, std::ios::binary);
 		if (!inputFile.get().is_open()) {
 			spdlog::error("Error: Could not open input file {}.", inputFileName);
-			Block& block = rdMem.GetBlock();
-			block.error = true;
-			rdMem.SignalBlock();  // Allow writer to get it and see error.
-			ReaderFinish(std::move(dataTransfer));
-			return EXIT_FAILURE;
+			return ReaderAbort(rdMem, std::move(dataTransfer));
 		}
 		inputFile.get().exceptions(std::ifstream::badbit);
 		spdlog::debug("Input file opened: {}", inputFileName);
+		std::streamoff offset = 0;
+		if (config.resume)
+		{
+			try
+			{
+				offset = CopyJournal{ config.outputFileName }.Prepare(inputFileName);
+				if (!inputFile.get().seekg(offset)) {
+					throw std::runtime_error(std::format("Failed to seek to offset {}.", offset));
+				}
+			}
+			catch (const std::exception& e) {
+				spdlog::error("Error: Could not resume copy of {}: {}", inputFileName, e.what());
+				return ReaderAbort(rdMem, std::move(dataTransfer));
+			}
+		}
 		try
 		{
 			// ReSharper disable once CppInitializedValueIsAlwaysRewritten // safety default value
 			bool finished = false;
+			std::optional<PipelineTuner> tuner;
+			if (config.autoTune)
+			{
+				tuner.emplace(blockSize, depth);
+			}
 			do
 			{
 				Block& block = rdMem.GetBlock();
-				finished = (BLOCK_SIZE != ReadFromFile(inputFileName, inputFile.get(), block));
+				block.offset = offset;
+				ReadFromFile(inputFileName, inputFile.get(), block, blockSize);
+				offset += block.size;
+				finished = block.last;
+				const std::streamsize loaded = block.size; // Block belongs to the writer after the signal.
 				rdMem.SignalBlock();  // Allow processing of the loaded block
+				if (tuner && !finished)
+				{
+					const auto settings = tuner->OnBlock(loaded, dataTransfer.GetStallTimes());
+					for (; depth < settings.depth; ++depth)
+					{
+						dataTransfer.GrowDepth();
+					}
+					for (; depth > settings.depth; --depth)
+					{
+						dataTransfer.ShrinkDepth();
+					}
+					blockSize = settings.blockSize;
+				}
 			} while (!finished);
+			if (tuner)
+			{
+				tuner->Report();
+			}
 		}
 		catch (const std::ios_base::failure& e) {
 			spdlog::error("I/O error while reading from file: {}: {}", inputFileName, e.what());
@@ -98,39 +168,70 @@ namespace
 		return EXIT_SUCCESS;
 	}
 
-	int DoWrite(const std::string& outputFileName, DataTransfer dataTransfer)
+	int DoWrite(const Config& config, DataTransfer dataTransfer)
 	{
 		spdlog::info("Writer process started.");
 		Semaphore finisher{ (getFinisherName(dataTransfer.GetName())) };
 		finisher.Signal();
 		DataTransfer::DataTransferInterface wrMem = dataTransfer.GetWriterInterface();
 
+		// Resume mode and block layout are in shared memory only after the reader handed out the first block.
+		// The first block is at the start of the ring whatever the layout is.
+		Block* nextBlock = &wrMem.GetBlock();
+		if (!dataTransfer.LayoutMatchesReader())
+		{
+			spdlog::error("Error: Reader was started with different --blocks, --block-size or --autotune.");
+			wrMem.SignalError();
+			return EXIT_FAILURE;
+		}
+
 		// open output file
 		// TODO: do not open if source file does not exist or is not readable
-		LoggingOfstream outputFile(outputFileName, std::ios::binary);
-		if (!outputFile.get().is_open()) {
+		const std::string& outputFileName = config.outputFileName;
+		std::optional<CopyJournal> journal;
+		if (dataTransfer.IsResuming())
+		{
+			journal.emplace(outputFileName);
+		}
+		if (journal.has_value() != config.resume)
+		{
+			spdlog::info("Reader was started {} --resume, the writer follows it.", journal ? "with" : "without");
+		}
+		// Keep already copied data when resuming. Reader decides what is valid, blocks carry their offset.
+		OutputFile outputFile(outputFileName, journal.has_value());
+		if (!outputFile.IsOpen()) {
 			spdlog::error("Error: Could not open output file {}.", outputFileName);
-			Block& block = wrMem.GetBlock();
-			block.error = true;
-			wrMem.SignalBlock();
+			wrMem.SignalError();
 			return EXIT_FAILURE;
 		}
-		outputFile.get().exceptions(std::ifstream::failbit | std::ifstream::badbit);
 		spdlog::debug("Output file opened: {}", outputFileName);
 		// ReSharper disable once CppInitializedValueIsAlwaysRewritten // safety default value
 		bool finished = false;
-		do // last block has full size
+		std::streamoff fileSize = 0;
+		do // last block is marked by reader
 		{
-			Block& block = wrMem.GetBlock();
+			Block& block = nextBlock ? *nextBlock : wrMem.GetBlock();
+			nextBlock = nullptr;
 			// Write to file from block.
 			spdlog::info("Writing a block #{}.", block.id);
-			outputFile.get().write(block.data, block.size);
+			outputFile.Write(block.offset, block.Data(), block.size);
+			if (journal)
+			{
+				journal->Confirm(outputFile, block.offset, block.Data(), block.size);
+			}
 			block.error = false;
 			spdlog::info("Wrote {} bytes.", block.size);
 
+			fileSize = block.offset + block.size;
+			finished = block.last;
 			wrMem.SignalBlock();
-			finished = (block.size < BLOCK_SIZE);
 		} while (!finished);
+		if (journal)
+		{
+			// Output kept from an interrupted copy may be longer than the source.
+			outputFile.Truncate(fileSize);
+			journal->Finish(outputFile);
+		}
 		spdlog::info("File saved");
 		return EXIT_SUCCESS;
 	}
@@ -150,28 +251,59 @@ namespace
 		spdlog::set_level(spdlog::level::debug);
 	}
 
-	struct Config
+	// Parses a numeric command-line value within [min, max]. Throws usage on anything else.
+	long long ParseNumber(const std::string_view value, const long long min, const long long max, const std::string& usage)
 	{
-		std::string inputFileName;
-		std::string outputFileName;
-		std::string sharedMemoryName;
-	};
+		long long result = 0;
+		const auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), result);
+		if (ec != std::errc{} || end != value.data() + value.size() || result < min || result > max) {
+			throw std::runtime_error(usage);
+		}
+		return result;
+	}
 
 	Config ReadCommandlineParameters(const int argc, const char* const* argv)
 	{
 		// Read command-line parameters here.
 		// Simplified parameter checking so we do not need to add dependencies.
 		spdlog::info("Command-line parameters: argc = {}, argv[0] = {}", argc, argv[0]);
-		spdlog::info(argv[1]);
-		spdlog::info(argv[2]);
-		spdlog::info(argv[3]);
-		if (argc != 4) {
-			throw std::runtime_error(std::format("Usage: {} <input_file> <output_file> <shared_mem_name>", argv[0]));
+		for (int i = 1; i < argc; ++i)
+		{
+			spdlog::info(argv[i]);
+		}
+		const std::string usage = std::format(
+			"Usage: {} <input_file> <output_file> <shared_mem_name> [--autotune] [--block-size <1..{}>] [--blocks <1..{}>] [--resume]"
+			" [--reader-cpu <cpu>] [--writer-cpu <cpu>] [--numa-node <node>]",
+			argv[0], BLOCK_CAPACITY, BLOCK_NUM);
+		if (argc < 4) {
+			throw std::runtime_error(usage);
 		}
 		Config config;
 		config.inputFileName = argv[1];
 		config.outputFileName = argv[2];
 		config.sharedMemoryName = argv[3];
+		// Block size and count are decided by the reader. With --autotune they are the starting point.
+		for (int i = 4; i < argc; ++i)
+		{
+			const std::string option = argv[i];
+			if (option == "--autotune") {
+				config.autoTune = true;
+			} else if (option == "--resume") {
+				config.resume = true;
+			} else if (option == "--block-size" && i + 1 < argc) {
+				config.blockSize = ParseNumber(argv[++i], 1, BLOCK_CAPACITY, usage);
+			} else if (option == "--blocks" && i + 1 < argc) {
+				config.blockDepth = static_cast<int>(ParseNumber(argv[++i], 1, BLOCK_NUM, usage));
+			} else if (option == "--reader-cpu" && i + 1 < argc) {
+				config.readerCpu = static_cast<int>(ParseNumber(argv[++i], 0, MAXSHORT, usage));
+			} else if (option == "--writer-cpu" && i + 1 < argc) {
+				config.writerCpu = static_cast<int>(ParseNumber(argv[++i], 0, MAXSHORT, usage));
+			} else if (option == "--numa-node" && i + 1 < argc) {
+				config.numaNode = static_cast<int>(ParseNumber(argv[++i], 0, MAXSHORT, usage));
+			} else {
+				throw std::runtime_error(usage);
+			}
+		}
 		return config;
 	}
 }
@@ -186,11 +318,21 @@ int main(const int argc, const char* const argv[]) {
 			const RoleCheck::Role role = roleCheck.GetRole();
 			const Config config = ReadCommandlineParameters(argc, argv);
 			std::ios::sync_with_stdio(false);
-			DataTransfer dataTransfer{ config.sharedMemoryName, role }; // Create shared memory and semaphores.
+			if (const int cpu = role == RoleCheck::Role::Reader ? config.readerCpu : config.writerCpu; cpu != ANY_CPU)
+			{
+				PinThreadToCpu(cpu);
+			}
+			// Both processes get the same parameters, so they agree on the node without talking.
+			const int numaNode = ChooseNumaNode(config.numaNode, config.readerCpu, config.writerCpu);
+			// Autotune may grow up to the largest blocks, otherwise only the configured blocks are allocated.
+			const BlockLayout layout = config.autoTune
+				? BlockLayout{ static_cast<int>(BLOCK_NUM), BLOCK_CAPACITY }
+				: BlockLayout{ config.blockDepth, config.blockSize };
+			DataTransfer dataTransfer{ config.sharedMemoryName, role, numaNode, layout }; // Create shared memory and semaphores.
 
 			switch (role) {
-			case RoleCheck::Role::Reader: resultCode = DoRead(config.inputFileName, std::move(dataTransfer)); break;
-			case RoleCheck::Role::Writer: resultCode = DoWrite(config.outputFileName, std::move(dataTransfer)); break;
+			case RoleCheck::Role::Reader: resultCode = DoRead(config, std::move(dataTransfer)); break;
+			case RoleCheck::Role::Writer: resultCode = DoWrite(config, std::move(dataTransfer)); break;
 			case RoleCheck::Role::Exit: resultCode = EXIT_FAILURE; break;
 			}
 		}